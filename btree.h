@@ -0,0 +1,149 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include "heapfile.h"
+
+// A B+-tree index on one attribute of a heap file.  The tree lives in
+// a file of its own and its nodes are read through the buffer pool
+// like any other page.  It is keyed on (attribute value, RID), so
+// every entry is distinct even where values repeat, and a delete names
+// exactly the entry it removes.  Leaves are chained left to right for
+// range scans.  Deletes never merge nodes: a leaf may be left empty,
+// and stays in the chain, which scans step over.
+
+const double BUILDFILL = 0.9;  // how full build packs each node
+
+struct IndexHdrPage
+{
+  char		relName[MAXNAMESIZE];	// heap file the index is on
+  int		attrOffset;	// the attribute, as startScan takes it
+  int		attrLength;
+  Datatype	attrType;
+  int		unique;		// 1 if no two records may share a value
+  int		rootPage;	// pageNo of the root
+  int		height;		// levels, 1 while the root is a leaf
+  int		entryCnt;	// entries in the tree
+};
+
+// Every node is a BTNode followed by count entries sorted by (key,
+// RID).  A leaf entry is a key of attrLength bytes and the RID of its
+// record; an inner entry is followed by the pageNo of the child that
+// holds the entries from it on, firstChild holding those below the
+// first.
+struct BTNode
+{
+  int		level;		// 0 for leaves
+  int		count;		// entries on the page
+  int		nextPage;	// right neighbour on the same level, -1 if none
+  int		firstChild;	// inner nodes only
+};
+
+// name of the file holding the index on the attribute at offset
+const string indexFileName(const string & relName, const int offset);
+
+class BTreeIndex
+{
+  friend class HeapFile;
+public:
+  // open the index stored in indexName
+  BTreeIndex(const string & indexName, Status& status);
+  ~BTreeIndex();
+
+  // Create an empty index in a new file indexName.  BADINDEXPARM if
+  // the attribute is not one a scan could filter on, or if fewer than
+  // three entries would fit on a page.
+  static const Status create(const string & indexName,
+                             const string & relName, const int offset,
+                             const int length, const Datatype type,
+                             const bool unique);
+
+  // Fill an empty index from entries, each a key followed by a RID,
+  // in any order.  They are sorted, packed into leaves BUILDFILL full
+  // from left to right and the levels above built one at a time.
+  // NONUNIQUEENTRY if the index is unique and two keys are equal.
+  const Status build(vector<char>& entries);
+
+  // add the entry for the record at rid whose attribute is key;
+  // NONUNIQUEENTRY if the index is unique and has key already
+  const Status insertEntry(const char* key, const RID& rid);
+  // remove the entry; RECNOTFOUND if there is no such entry
+  const Status deleteEntry(const char* key, const RID& rid);
+  // whether some entry has key
+  const Status contains(const char* key, bool& found);
+  // the RIDs of all records whose attribute equals key, in RID order
+  const Status lookup(const char* key, vector<RID>& rids);
+
+  // Scan the entries whose key lies between low and high, in key
+  // order.  lowOp is GT or GTE and highOp LT or LTE; a NULL bound
+  // leaves that end open.  BADSCANPARM for any other operator.
+  const Status startScan(const char* low, const Operator lowOp,
+                         const char* high, const Operator highOp);
+  // RID of the next entry of the scan; NOMORERECS after the last
+  const Status scanNext(RID& rid);
+  const Status endScan();
+
+  const int getAttrOffset() const { return hdr->attrOffset; }
+  const int getAttrLength() const { return hdr->attrLength; }
+  const Datatype getAttrType() const { return hdr->attrType; }
+  const bool isUnique() const { return hdr->unique != 0; }
+  const int getEntryCnt() const { return hdr->entryCnt; }
+  const int getHeight() const { return hdr->height; }
+
+  // log the changes to the pinned header page, for HeapFile::commit
+  const Status logHeader();
+
+private:
+  // insertEntry without the uniqueness check, for HeapFile, which has
+  // made it already
+  const Status addEntry(const char* key, const RID& rid);
+
+  File*		file;
+  IndexHdrPage*	hdr;		// pinned header page
+  int		hdrPageNo;
+  bool		hdrDirty;
+  int		keyLen;		// attrLength
+  int		leafSize;	// bytes per leaf entry: key and RID
+  int		innerSize;	// bytes per inner entry: key, RID and child
+  int		leafCap;	// entries a leaf holds
+  int		innerCap;	// entries an inner node holds
+
+  // the scan
+  bool		scanning;
+  int		scanPageNo;	// pinned leaf, -1 once past the last one
+  BTNode*	scanNode;
+  int		scanPos;	// next entry of scanNode to look at
+  vector<char>	scanHigh;	// upper bound, empty if none
+  Operator	scanHighOp;
+
+  char* leafEntry(BTNode* node, const int i) const
+    { return (char*) (node + 1) + i * leafSize; }
+  char* innerEntry(BTNode* node, const int i) const
+    { return (char*) (node + 1) + i * innerSize; }
+  int& childOf(char* innerEntry) const
+    { return *(int*) (innerEntry + keyLen + sizeof(RID)); }
+
+  // compare two keys, or a key and RID with an entry's
+  int compareKeys(const char* a, const char* b) const;
+  int compareEntry(const char* key, const RID& rid, const char* entry) const;
+  // first position in node whose entry is not below (key, rid)
+  int lowerBound(BTNode* node, const char* key, const RID& rid) const;
+  // first position in an inner node whose entry is above (key, rid)
+  int upperBound(BTNode* node, const char* key, const RID& rid) const;
+
+  // Walk down to the leaf where (key, rid) belongs, leaving it pinned
+  // in node; path, if given, gets the inner nodes on the way, root
+  // first.
+  const Status findLeaf(const char* key, const RID& rid, int& pageNo,
+                        BTNode*& node, vector<int>* path);
+  // unpin leaf pageNo and pin its right neighbour; pageNo is -1 and
+  // node NULL if there is none
+  const Status nextLeaf(int& pageNo, BTNode*& node);
+  // Pin the leaf holding the first entry not below (key, rid) and set
+  // pos to it, moving right past leaves with nothing left; pageNo is
+  // -1 and nothing is pinned if there is no such entry.
+  const Status seek(const char* key, const RID& rid, int& pageNo,
+                    BTNode*& node, int& pos);
+  const Status newNode(const int level, int& pageNo, BTNode*& node);
+};
+
+#endif
@@ -1,34 +1,59 @@
 #ifndef BUF_H
 #define BUF_H
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "db.h"
 // define if debug output wanted
 //#define DEBUGBUF
 
-// declarations for buffer pool hash table
+// declarations for buffer pool hash table.  A bucket is one slot of
+// an open-addressing array; file == NULL marks an empty slot.
 struct hashBucket
 {
-	File*	file;    // pointer a file object (more on this below)
+	const File* file;    // pointer a file object (more on this below)
 	int	pageNo;  // page number within a file
 	int	frameNo; // frame number of page in the buffer pool
-	hashBucket* 	next;	 // next node in the hash table
+};
+
+// one independently latched piece of the hash table: a power-of-two
+// array of buckets searched by linear probing.  Entries are removed by
+// shifting later members of the probe run back, so there are no
+// tombstones and lookups stop at the first empty bucket.
+struct hashPartition
+{
+	std::mutex   latch;  // guards everything below
+	hashBucket*  bucket; // bucket array, mask+1 entries
+	unsigned int mask;   // number of buckets - 1
+	unsigned int count;  // number of buckets in use
 };
 
 
-// hash table to keep track of pages in the buffer pool
+// hash table to keep track of pages in the buffer pool.  The key is
+// split into partitions by the high bits of its hash so that threads
+// looking up unrelated pages do not serialize, and each partition is a
+// flat preallocated array, so neither insert nor remove allocates.
 class BufHashTbl
 {
 private:
     int HTSIZE;
-    hashBucket**  ht; // actual hash table
-    int	 hash(const File* file, const int pageNo); // returns value between 0 and HTSIZE-1
+    int NUMPARTS;          // number of independently latched partitions
+    hashPartition* parts;  // actual hash table
+    unsigned long long hash(const File* file, const int pageNo); // mixed 64-bit hash
+    void grow(hashPartition& part); // double a partition that filled up
 
 public:
     BufHashTbl(const int htSize);  // constructor
     ~BufHashTbl(); // destructor
 	
     // insert entry into hash table mapping (file,pageNo) to frameNo;
-    // returns 0 if OK, HASHTBLERROR if an error occurred
+    // returns 0 if OK, HASHTBLERROR if an error occurred (including the
+    // case where another thread already inserted (file,pageNo))
   Status insert(const File* file, const int pageNo, const int frameNo);
 
     // Check if (file,pageNo) is currently in the buffer pool (ie. in
@@ -44,17 +69,25 @@ public:
 
 class BufMgr;  //forward declaration of BufMgr class 
 
-// class for maintaining information about buffer pool frames
+// class for maintaining information about buffer pool frames.
+// file, pageNo and valid only change while latch is held; pinCnt is
+// only incremented while latch is held but may be decremented (by
+// unPinPage) at any time, so a frame seen unpinned under the latch
+// stays unpinned until the latch is released.
 class BufDesc {
     friend class BufMgr;
 private:
   File* file;   // pointer to file object
   int   pageNo; // page within file
   int	frameNo;  // frame # of frame
-  int   pinCnt; // number of times this page has been pinned
-  bool 	dirty;	  // true if dirty;  false otherwise
+  std::atomic<int>  pinCnt; // number of times this page has been pinned
+  std::atomic<bool> dirty;  // true if dirty;  false otherwise
   bool 	valid;   // true if page is valid
-  bool  refbit;	 // has this buffer frame been reference recently
+  bool  prefetched; // read ahead and not yet asked for by readPage
+  unsigned long long lsn; // last log record of the page, 0 if none
+  int   prevInFile; // neighbours in the list of frames of file, -1 at
+  int   nextInFile; // either end; guarded by the file's frameLatch
+  std::mutex latch;  // held while frame identity or contents are in flux
 
   void Clear() {  // initialize buffer frame for a new user
     	pinCnt = 0;
@@ -62,6 +95,8 @@ private:
 	pageNo = -1;
     	dirty = false;
 	valid = false;
+	prefetched = false;
+	lsn = 0;
   };
 
   void Set(File* filePtr, int pageNum) { 
@@ -70,24 +105,47 @@ private:
       pinCnt = 1;
       dirty = false;
       valid = true;
-      refbit = true;
+      prefetched = false;
+      lsn = 0;
   }
 
   BufDesc() {
       Clear();
+      prevInFile = -1;
+      nextInFile = -1;
   }
 };
 
 
+// Buffer pool statistics.  The counters are striped atomics (see
+// metrics.h), cheap enough to stay on under concurrent use; per-file
+// breakdowns are kept in each File's FileStats.
 struct BufStats
 {
-  int accesses;    // Total number of accesses to buffer pool
-  int diskreads;   // Number of pages read from disk (including allocs)
-  int diskwrites;  // Number of pages written back to disk
+  Counter accesses;    // Total number of accesses to buffer pool
+  Counter diskreads;   // Number of pages read from disk (including allocs)
+  Counter diskwrites;  // Number of pages written back to disk
+  Counter prefetchreads;  // Pages read from disk by read-ahead
+  Counter prefetchhits;   // Read-ahead pages later asked for
+  Counter prefetchwasted; // Read-ahead pages dropped unused
+  Counter syncwrites;  // Evictions that had to write the victim first
+  Counter writeruns;   // Multi-page writes issued (one per run)
+  Counter evictions;   // Valid pages evicted by the replacement policy
+  Counter ringevictions;  // Valid pages evicted by reusing a scan ring frame
+  Counter allocs;      // Pages allocated
+  Counter disposes;    // Pages disposed of
+  LatencyHistogram missLatency;  // readPage calls that had to read the
+                                 // page; its count is the number of misses
 
   void clear()
     {
-      accesses = diskreads = diskwrites = 0;
+      accesses.clear();
+      diskreads.clear(); diskwrites.clear();
+      prefetchreads.clear(); prefetchhits.clear(); prefetchwasted.clear();
+      syncwrites.clear(); writeruns.clear();
+      evictions.clear(); ringevictions.clear();
+      allocs.clear(); disposes.clear();
+      missLatency.clear();
     }
       
   BufStats()
@@ -97,37 +155,248 @@ struct BufStats
 };
 
 
+const int WRITEBATCH = 32;  // most frame latches the page writer holds at once
+const int SCANRING = 16;    // default number of frames in a scan ring
+
+// buffer replacement policies
+enum ReplPolicy {
+  REPL_CLOCK,   // clock with one reference bit per frame
+  REPL_2Q,      // 2Q: a FIFO for pages seen once, LRU for the rest
+  REPL_ARC      // adaptive replacement cache
+};
+
+// A replacement policy.  BufMgr tells it about every hit, load and
+// removal and asks it for victims; it keeps whatever state it needs,
+// guarded by its own latch.  It never waits for a frame latch, so it
+// may be called with one held.
+class Replacer
+{
+public:
+  virtual ~Replacer() {}
+
+  // a readPage found its page in frame
+  virtual void hit(const int frame) = 0;
+  // Find a frame for (file, pageNo), which is about to be read in.
+  // Frames are offered to take, best first, until it accepts one and
+  // returns with its latch held; victim takes it off its lists and
+  // returns it, -1 if none was accepted.  The caller empties the
+  // frame, once the policy's own latch is released.
+  virtual int victim(const File* file, const int pageNo,
+                     const std::function<bool(int)>& take) = 0;
+  // frame now holds (file, pageNo), whatever it held before.  Cold
+  // pages (read ahead, or through a scan ring) go where they are the
+  // next to be evicted.
+  virtual void loaded(const int frame, const File* file, const int pageNo,
+                      const bool cold) = 0;
+  // frame was emptied other than through victim
+  virtual void removed(const int frame) = 0;
+  // append up to count frames in roughly the order victim would offer
+  // them, for the page writer to clean ahead of time
+  virtual void upcoming(std::vector<int>& frames, const int count) = 0;
+};
+
+Replacer* newReplacer(const ReplPolicy policy, const int numBufs);
+
+// A scan ring: a few frames that one sequential scan reads its pages
+// into, round robin, so that a scan of a table larger than the pool
+// does not push the rest of the pool out.  Pages already in the pool
+// are used where they are.  A ring is used by one thread at a time.
+class BufRing
+{
+  friend class BufMgr;
+public:
+  BufRing(const int size = SCANRING) : size(size), next(0) {}
+
+private:
+  struct ringSlot {
+    const File* file;  // page the ring read into frameNo
+    int pageNo;
+    int frameNo;
+  };
+  std::vector<ringSlot> slots;
+  int size;
+  int next;   // slot to reuse next once all are in use
+};
+
+// one readPage call, as recorded by BufMgr::setTrace
+struct BufAccess
+{
+  const File* file;
+  int pageNo;
+  bool ring;     // made through a scan ring
+};
+
+// The buffer manager may be shared by several threads.  Frames are
+// protected by per-frame latches, the page table by partition latches
+// and pin counts are atomic; no latch is held across calls.
+
 class BufMgr 
 {
 private:
-  unsigned int 	 clockHand;
   int   	 numBufs;    	// Number of pages in buffer pool
+  Replacer*	 replacer;	// replacement policy
   BufHashTbl*    hashTable;  	// hash table mapping (File, page) to frame
   BufDesc*	 bufTable;  	// vector of status info, 1 per page
   BufStats	 bufStats;	// buffer pool statistics
+  int		 pageSize;	// bytes per frame
 
-  const Status allocBuf(int & frame);   // allocate a free frame.  
-  const void releaseBuf(int frame); // return unused frame to end of list
-  void advanceClock()
+  Page* framePtr(const int frameNo)  // start of a frame in bufPool
   {
-	clockHand = (clockHand + 1) % numBufs;
+	return (Page*) (bufPool + (size_t) frameNo * pageSize);
   }
 
+  // allocate a free frame for (file, pageNo).  On success the frame is
+  // returned with its latch held and no longer reachable through the
+  // hash table.
+  const Status allocBuf(int & frame, const File* file, const int pageNo);
+  const void releaseBuf(int frame); // return unused frame to end of list
+  // the same, reusing the frame of ring whose turn it is if that still
+  // holds the page the ring read into it and nobody has it pinned
+  const Status allocRingBuf(int & frame, BufRing* ring, const File* file,
+                            const int pageNo);
+  // empty the latched, unpinned frame, writing its page out if dirty
+  const Status evict(BufDesc* tmpbuf);
+
+  // Every valid frame is on the list of frames of its file, kept in
+  // the File, so that flushing a file visits only its own pages.  A
+  // frame is linked once Set and unlinked before it is Cleared, with
+  // its latch held.
+  void linkFrame(BufDesc* tmpbuf);
+  void unlinkFrame(BufDesc* tmpbuf);
+  // this pool's list in file, NULL if it has no frames there; the
+  // caller holds file->frameLatch
+  File::frameList* frameListOf(const File* file);
+
+  // readPage proper; a prefetching read does not count as a reference
+  // and marks a frame it has to fill as prefetched
+  const Status fetchPage(File* file, const int PageNo, Page*& page,
+                         const bool prefetch, BufRing* ring);
+
+  std::atomic<bool>        tracing;
+  std::mutex               traceLatch;     // guards trace
+  std::vector<BufAccess>*  trace;
+
+  // asynchronous read-ahead.  Requests are queued for a small pool of
+  // I/O threads, each of which follows the nextPage chain of the pages
+  // it reads for up to depth pages.
+  struct prefetchReq {
+    File* file;
+    int   pageNo;
+    int   depth;
+    const void* owner;  // requester, so a newer request can supersede it
+  };
+  std::deque<prefetchReq>  prefetchQueue;
+  std::mutex               prefetchLatch;  // guards the fields below
+  std::condition_variable  prefetchWork;   // request queued or shutdown
+  std::condition_variable  prefetchDone;   // an I/O thread finished a request
+  std::vector<std::thread> ioThreads;
+  std::vector<const File*> inFlight;       // file each I/O thread is reading
+  bool                     shuttingDown;
+  void ioWorker(const int id);
+
+  // background page writer.  It wakes when the fraction of dirty
+  // frames passes highWater and cleans until it is back at lowWater;
+  // otherwise it periodically cleans the next frames the replacement
+  // policy would evict, so that eviction seldom finds a dirty victim.
+  std::atomic<int>         numDirty;       // frames with dirty set
+  std::atomic<float>       highWater;
+  std::atomic<float>       lowWater;
+  std::mutex               writerLatch;    // guards writerStop
+  std::condition_variable  writerWake;
+  bool                     writerStop;
+  std::thread              writerThread;
+  void pageWriter();
+  // clean dirty, unpinned frames among the first count the policy
+  // would evict, stopping after maxPages; returns the number cleaned
+  int  cleanFrames(const int count, const int maxPages);
+
+  // a frame and the page it held when it was picked for writing
+  struct frameRef {
+    const File* file;
+    int pageNo;
+    int frameNo;
+    bool operator < (const frameRef& other) const {
+      return file != other.file ? file < other.file : pageNo < other.pageNo;
+    }
+  };
+  // latch the frames in refs (sorted), WRITEBATCH at a time, recheck
+  // that each still holds its page and write out the dirty ones.  With
+  // drop the pages are also removed from the pool and a pinned page is
+  // an error; otherwise busy or pinned frames are skipped.
+  const Status flushFrames(const std::vector<frameRef>& refs, const bool drop);
+  // write out frames, whose latches the caller holds, sorting them by
+  // (file, pageNo) so that each run of consecutive pages goes out in
+  // one vectored write
+  const Status writeFrames(std::vector<int>& frames);
+  void markDirty(BufDesc* tmpbuf);
+  void markClean(BufDesc* tmpbuf);
+
+  // redo logging (see wal.h).  For frames holding pages of a logged
+  // file, images has a copy of each page as the log last saw it.
+  char*          images;
+  std::once_flag imagesOnce;
+  char* imagePtr(const int frameNo);
+  // take the image of a page just read in, or log a page just
+  // allocated; the caller holds the frame latch
+  void logLoaded(BufDesc* tmpbuf, const bool allocated);
+  // log the changes to a pinned frame since its image was taken
+  void logChanges(BufDesc* tmpbuf);
+  // the log must have a page's changes before the page is written
+  const Status logBefore(const File* file, const unsigned long long lsn);
+
 
 public:
-  Page*	         bufPool;   // actual buffer pool
+  char*	         bufPool;   // actual buffer pool, bufs frames of pageSize
 
-  BufMgr(const int bufs);
+  // the pool only holds pages of files whose page size is pageSize;
+  // the others are refused with BADPAGESIZE.  If the pool cannot be
+  // set up, status says why and the pool holds no frames.
+  BufMgr(const int bufs, Status& status, const int numIOThreads = 2,
+         const int pageSize = PAGESIZE,
+         const ReplPolicy policy = REPL_CLOCK);
   ~BufMgr();
 
-  const Status readPage(File* file, const int PageNo, Page*& page);
+  // pin a page and return its frame.  Pages of files opened with
+  // IO_MMAP are returned in place, without a frame or a pin, and
+  // unPinPage on them does nothing.  With a ring, a page that has to
+  // be read in goes into one of the ring's frames.
+  const Status readPage(File* file, const int PageNo, Page*& page,
+                        BufRing* ring = NULL);
+
+  // record every readPage call in trace from now on, until called
+  // with NULL
+  void setTrace(std::vector<BufAccess>* trace);
+
+  // queue an asynchronous read of pageNo and of the depth-1 pages
+  // that follow it on its nextPage chain.  Pages are left unpinned in
+  // the pool; nothing is read if there are no I/O threads.  A request
+  // with an owner replaces one from the same owner still in the queue,
+  // so a scan that outruns the I/O threads does not leave a backlog of
+  // read-ahead for pages it has already passed.
+  const Status prefetchPage(File* file, const int PageNo, const int depth,
+                            const void* owner = NULL);
+  // drop queued read-ahead for file and wait for reads in progress
+  void cancelPrefetch(const File* file);
+
+  // With dirty, the changes made to a page of a logged file while it
+  // was pinned go to the log.
   const Status unPinPage(File* file, const int PageNo, const bool dirty);
+  // log the changes to a page the caller has pinned and mark it dirty,
+  // as unPinPage with dirty would, but keep the pin
+  const Status logPage(File* file, const int PageNo);
   const Status allocPage(File* file, int& PageNo, Page*& page); 
                         // allocates a new, empty page 
   const Status flushFile(const File* file); // writing out all dirty pages of the file
-  const Status disposePage(File* file, const int PageNo); // dispose of page in file
+
+  // fractions of the pool that start (high) and stop (low) background
+  // cleaning; returns BADBUFFER unless 0 <= low <= high <= 1
+  const Status setDirtyWatermarks(const float high, const float low);
+  // dispose of page in file; PAGEPINNED if someone has it pinned
+  const Status disposePage(File* file, const int PageNo);
   void  printSelf();
 
+  const int getPageSize() const { return pageSize; }
+
   const BufStats & getBufStats() const // get buffer pool usage
   {
 	return bufStats;
@@ -136,6 +405,14 @@ public:
   {
 	bufStats.clear();
   }
+  // the pool and per-file statistics, for toJSON or toPrometheus.
+  // Per-file counters are not reset by clearBufStats.
+  MetricsSnapshot snapshot() const
+  {
+	MetricsSnapshot s;
+	s.take(bufStats);
+	return s;
+  }
 };
 
 #endif
@@ -3,7 +3,12 @@
 
 #include <sys/types.h>
 #include <functional>
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include "error.h"
+#include "page.h"
+#include "metrics.h"
 #include <string.h>
 using namespace std;
 
@@ -14,21 +19,73 @@ using namespace std;
 
 // forward class definition for db
 class DB;
+class LogMgr;
+class BufMgr;
+
+// structure of DB (header) page
+
+typedef struct {
+  int nextFree;                         // page # of next page on free list
+  int firstPage;                        // page # of first page in file
+  int numPages;                         // total # of pages in file
+  int pageSize;                         // size of every page in the file
+} DBPage;
+
+const int EXTENTPAGES = 64;   // default number of pages a file grows by
+
+// how a file moves pages between disk and memory
+enum IOMode {
+  IO_PREAD,   // pread/pwrite, one system call per page
+  IO_MMAP,    // file mapped into memory; the buffer manager hands out
+              // pointers into the mapping instead of copying pages
+  IO_DIRECT   // O_DIRECT, bypassing the OS page cache; falls back to
+              // IO_PREAD where the file system refuses it
+};
+
+const size_t MAPSPAN = (size_t) 1 << 30; // address space mapped per file
+const int DIRECTALIGN = 512;  // buffer alignment O_DIRECT transfers need
 
 // class definition for open files
 class File {
   friend class DB;
   friend class OpenFileHashTbl;
+  friend class LogMgr;
+  friend class BufMgr;
 
  public:
 
   Status allocatePage(int& pageNo);     // allocate a new page
+  // reserve numPages consecutive new pages at the end of the file,
+  // leaving the free list alone; firstPageNo is the first of them
+  const Status allocatePages(const int numPages, int& firstPageNo);
+  // give back reserved pages that went unused
+  const Status releasePages(const int firstPageNo, const int numPages);
   const Status disposePage(const int pageNo);       // release space for a page
   const Status readPage(const int pageNo,
 		  Page* pagePtr) const;       // read page from file
   const Status writePage(const int pageNo,
 		   const Page* pagePtr);      // write page to file
+  const Status writePages(const int pageNo, const Page* pages[],
+		   const int numPages);       // write a run of consecutive pages
+  const Status readPages(const int pageNo, Page* pages[],
+		  const int numPages) const;  // read a run of consecutive pages
   const Status getFirstPage(int& pageNo) const;     // returns pageNo of first page
+  const int getSysCalls() const { return numSysCalls; } // system calls issued
+  const IOMode getIOMode() const { return ioMode; }
+  // counters and I/O latencies of this file, kept by name
+  FileStats* getStats() const { return stats; }
+  const int getPageSize() const { return pageSize; }
+  // the redo log the file's changes go to, NULL if none (see wal.h),
+  // and the id they go under
+  LogMgr* getLog() const { return log; }
+  const int getLogId() const { return logId; }
+  // add n to the count of heap file scans open on the file, returning
+  // the new count
+  const int addScans(const int n) { return scanCnt += n; }
+
+  // address of pageNo within the file's mapping, or NULL if the file
+  // is not mapped or the page lies beyond the mapped part of the file
+  Page* mappedPage(const int pageNo) const;
 
   bool operator == (const File & other) const
     {
@@ -40,11 +97,14 @@ class File {
   File(const string &fname);                   // initialize
   ~File();                  // deallocate file object
 
-  static const Status create(const string &fileName);
+  static const Status create(const string &fileName, const int pageSize);
   static const Status destroy(const string &fileName);
 
-  const Status open();
+  const Status open(const IOMode mode);
   const Status close();
+  const Status flushHeader();           // write back the cached header
+  void logHeader();                     // log the cached header; hdrLatch held
+  const Status extend(const int pages); // preallocate more pages
 
   const Status intread(const int pageNo,
 		 Page* pagePtr) const;        // internal file read
@@ -58,6 +118,30 @@ class File {
   string fileName;                    // The name of the file
   int openCnt;                        // # times file has been opened
   int unixFile;                       // unix file stream for file
+  IOMode ioMode;                      // backend chosen at first open
+  int pageSize;                       // from the header, fixed for the file
+  char* mapBase;                      // start of the mapping (IO_MMAP)
+  mutable std::mutex hdrLatch;        // guards the fields below
+  DBPage header;                      // cached copy of the header page
+  bool hdrDirty;                      // header differs from page 0
+  int extentPages;                    // pages to preallocate at a time
+  std::atomic<int> allocPages;        // pages the file has room for
+  mutable std::atomic<int> numSysCalls; // I/O system calls so far
+  FileStats* stats;                   // from getFileStats(fileName)
+  LogMgr* log;                        // set by DB::openFile, or NULL
+  int logId;
+  unsigned long long hdrLsn;          // last log record of the header
+  std::atomic<int> scanCnt;           // heap file scans open on the file
+  // the buffer frames holding pages of the file in one pool, linked
+  // by that BufMgr from first, -1 if none; one entry for each pool
+  // that has some
+  struct frameList {
+    BufMgr* pool;
+    int first;
+    int count;
+  };
+  mutable std::mutex frameLatch;      // guards frameLists
+  std::vector<frameList> frameLists;
 };
 
 class BufMgr;
@@ -72,13 +156,17 @@ struct fileHashBucket
 	
 };
 
-// hash table to keep track of open files
+// hash table to keep track of open files.  It doubles once it holds
+// more files than it has buckets, so chains stay short however many
+// files are open.
 class OpenFileHashTbl
 {
 private:
     int HTSIZE;
+    int numEntries;       // files in the table
     fileHashBucket**  ht; // actual hash table
     int	 hash(string fileName);  // returns value between 0 and HTSIZE-1
+    void grow();          // double HTSIZE and rehash
 
 public:
     OpenFileHashTbl();
@@ -106,20 +194,39 @@ class DB {
   const Status createFile(const string & fileName) ;  // create a new file
   const Status destroyFile(const string & fileName) ; // destroy a file, 
                                                            // release all space
-  const Status openFile(const string & fileName, File* & file);  // open a file
+  // open a file.  The I/O mode applies when the file is not already
+  // open; otherwise the file keeps the mode it was first opened with.
+  const Status openFile(const string & fileName, File* & file,
+                        const IOMode mode = IO_PREAD);
   const Status closeFile(File* file);         // close a file
 
+  // number of pages files opened from now on grow by when they need
+  // room; returns BADPAGENO if pages < 1
+  const Status setExtentSize(const int pages);
+
+  // size of the pages of files created from now on; returns
+  // BADPAGESIZE unless it is a power of two between MINPAGESIZE and
+  // MAXPAGESIZE.  Existing files keep the size they were created with.
+  const Status setPageSize(const int size);
+  const int getPageSize() const { return pageSize; }
+
+  // Recover from logName (see wal.h) and log the changes to every
+  // file opened from now on there.  FILEOPEN if any file is open or a
+  // log already is.
+  const Status openLog(const string & logName);
+  // Make the files logged so far durable and stop logging; FILEOPEN
+  // if any file is still open.
+  const Status closeLog();
+  LogMgr* getLog() const { return log; }
+
  private:
   OpenFileHashTbl   openFiles;    // list of open files
+  int               numOpen;      // files in openFiles
+  LogMgr*           log;          // redo log, or NULL
+  std::mutex        latch;        // guards openFiles and open counts
+  int               extentPages;  // growth increment for opened files
+  int               pageSize;     // page size for created files
 };
 
 
-// structure of DB (header) page
-
-typedef struct {
-  int nextFree;                         // page # of next page on free list
-  int firstPage;                        // page # of first page in file
-  int numPages;                         // total # of pages in file
-} DBPage;
-
 #endif
@@ -17,7 +17,8 @@ enum Status {
 // File and DB errors
 
        BADFILEPTR, BADFILE, FILETABFULL, FILEOPEN, FILENOTOPEN,
-       UNIXERR, BADPAGEPTR, BADPAGENO, FILEEXISTS,
+       UNIXERR, BADPAGEPTR, BADPAGENO, FILEEXISTS, BADPAGESIZE,
+       BADFILEFORMAT,
 
 // BufMgr and HashTable errors
 
@@ -9,6 +9,7 @@
 using namespace std;
 
 #include "page.h"
+#include "paxpage.h"
 #include "buf.h"
 
 extern DB db;
@@ -18,10 +19,72 @@ extern DB db;
 
 // Some constant definitions
 const unsigned MAXNAMESIZE = 50;
+const int READAHEAD = 8;        // default read-ahead depth of a scan, in pages
+const int FETCHPINS = 4;        // pages getRecords keeps pinned by default
+const int LOADRUN = 64;         // pages a direct load reserves and writes at once
+const int MAXFSMPAGES = 128;    // free-space map pages a heap file can have
+const int SCANCHUNK = 8;        // pages a parallel scan thread takes at a time
+const int MAXINDEXES = 4;       // B+-tree indexes a heap file can have
 
 enum Datatype { STRING, INTEGER, FLOAT };    // attribute data types
 enum Operator { LT, LTE, EQ, GTE, GT, NE };  // scan operators
 
+// words in a selection bitmap, one bit for each slot a page can have
+const int SELWORDS = MAXPAGESIZE / sizeof(slot_t) / 64;
+
+// One term of a scan filter: the attribute at offset, length bytes
+// long, compared with value.  test is chosen by compileConjunct for the
+// term's type and operator; it clears the bits of sel for the records
+// of page that fail the term.
+struct Conjunct;
+typedef void (*PageTest)(const Conjunct& c, const Page* page,
+                         unsigned long long* sel);
+// The same for a PAX page: clears the bits of sel[0..(n+63)/64) whose
+// value fails the term, value i being at attr + i * stride.
+typedef void (*ColumnTest)(const Conjunct& c, const char* attr,
+                           const int stride, const int n,
+                           unsigned long long* sel);
+
+struct Conjunct
+{
+  int		offset;		// byte offset of attribute
+  int		length;		// length of attribute
+  Datatype	type;		// datatype of attribute
+  Operator	op;		// comparison operator
+  const char*	value;		// comparison value
+  PageTest	test;		// compiled test
+  ColumnTest	columnTest;	// compiled test for PAX pages
+};
+
+// check c and set its test; BADSCANPARM if c is not a valid term
+const Status compileConjunct(Conjunct& c);
+
+// Evaluate the conjunction of terms[0..numTerms) on every record of
+// page.  Bit i % 64 of sel[i / 64] is set if slot i holds a record that
+// satisfies all the terms; returns the number of such records.
+const int evalPage(const Conjunct terms[], const int numTerms,
+                   const Page* page, unsigned long long* sel);
+
+// evalPage for a PAX page: terms must each lie within one column
+const int evalPaxPage(const Conjunct terms[], const int numTerms,
+                      const PaxPage* page, const PaxSchema& schema,
+                      unsigned long long* sel);
+
+// whether terms compiled from now on may use SIMD instructions, where
+// the CPU has them; on by default
+void setPredicateSimd(const bool on);
+
+// an attribute a heap file has an index on (see btree.h)
+struct IndexInfo
+{
+  int		offset;		// byte offset of attribute
+  int		length;		// length of attribute
+  Datatype	type;		// datatype of attribute
+  int		unique;		// 1 if no two records may share a value
+};
+
+enum Layout { ROWLAYOUT, PAXLAYOUT };     // data page formats
+
 struct FileHdrPage
 {
   char		fileName[MAXNAMESIZE];   // name of file
@@ -29,10 +92,56 @@ struct FileHdrPage
   int		lastPage;	// pageNo of last data page in file
   int		pageCnt;	// number of pages
   int		recCnt;		// record count
+  int		fsmPages[MAXFSMPAGES];	// free-space map pages, -1 if not yet needed
+  unsigned char	fsmMax[MAXFSMPAGES];	// no entry of fsmPages[i] is larger
+  int		dirFirst;	// first page of the page directory
+  int		dirLast;	// last page of the page directory
+  int		indexCnt;	// number of indexes on the file
+  IndexInfo	indexes[MAXINDEXES];	// the indexed attributes
+  int		layout;		// a Layout: Page or PaxPage data pages
+  int		colCnt;		// PAX only: columns of the records,
+  int		colLen[MAXCOLUMNS];	// and their lengths in order
 };
 
+// Create a heap file of PAX pages for records of colCnt fixed-width
+// columns, colLens[i] bytes each.  Its records must be exactly as long
+// as all the columns together (INVALIDRECLEN otherwise), and its scan
+// filters must each lie within one column (BADSCANPARM otherwise).
+const Status createPaxHeapFile(const string fileName, const int colCnt,
+                               const int colLens[]);
+
+// The free-space map has one byte per page of the file: byte
+// pageNo % pageSize of map page fsmPages[pageNo / pageSize] holds the
+// free space on data page pageNo in units of pageSize/256 bytes,
+// rounded down.  0 also stands for pages the map knows nothing about,
+// so an out-of-date entry can only hide space, never promise it.
+
+// The page directory lists every data page of the file, in no
+// particular order, so that the pages can be handed out without
+// walking the chain.  It is a chain of its own of directory pages,
+// each a DirPage followed by count page numbers; only the last one is
+// not full.
+struct DirPage
+{
+  int		nextPage;	// next directory page, -1 if none
+  int		count;		// page numbers on this page
+};
+
+inline int* dirEntries(DirPage* dir) { return (int*) (dir + 1); }
+inline int dirCapacity(const int pageSize)
+{
+  return (pageSize - sizeof(DirPage)) / sizeof(int);
+}
 
-// class definition of heapFile
+
+class BTreeIndex;
+
+// class definition of heapFile.  The file's indexes are opened with it
+// and kept up to date by InsertFileScan::insertRecord and
+// HeapFileScan::deleteRecord.  A record too short to hold an indexed
+// attribute is left out of that index.  Changing an indexed attribute
+// in place (through markDirty) is not seen by the index; delete and
+// insert the record instead.
 class HeapFile {
 protected:
    File* 	filePtr;        // underlying DB File object
@@ -45,6 +154,58 @@ protected:
    bool  	curDirtyFlag;   // true if page has been updated
    RID   	curRec;         // rid of last record returned
 
+   Page*	fsmPage;	// pinned free-space map page, or NULL
+   int		fsmIndex;	// its index in headerPage->fsmPages
+   bool		fsmDirty;	// true if fsmPage has been updated
+   int		fsmNext;	// page number to resume the map search at
+
+   // pin map page index, allocating it first if create is set;
+   // fsmPage is left NULL if the page does not exist
+   const Status fsmPin(const int index, const bool create);
+   // make pageNo the current page, unpinning the one there now
+   const Status setCurPage(const int pageNo);
+   // record the free space on a data page
+   const Status setFreeSpace(const int pageNo, const int freeBytes);
+   // find a data page with at least needed bytes free; NOSPACE if the
+   // map knows of none
+   const Status findFreePage(const int needed, int& pageNo);
+   // add a data page to the page directory, or take one out of it
+   const Status dirAppend(const int pageNo);
+   const Status dirRemove(const int pageNo);
+   const Status dirTrim();  // drop the empty last directory page
+   // read the page numbers of all data pages from the directory
+   const Status getDataPages(vector<int>& pages);
+
+   // Data page access for either layout.  pax is NULL for row files;
+   // for PAX files getPageRecord puts the record together in buf,
+   // which must hold pax->recLen bytes.
+   PaxSchema*	pax;
+   vector<char>	paxRec;		// buf for getRecord
+   void pageInit(Page* page, const int pageNo) const;
+   const int pageFreeSpace(const Page* page) const;
+   const bool pageFits(const Record & rec) const;
+   const Status pageInsert(Page* page, const Record & rec, RID& rid) const;
+   const Status pageDelete(Page* page, const RID & rid) const;
+   const Status pageFirst(const Page* page, RID& rid) const;
+   const Status pageNext(const Page* page, const RID & cur, RID& next) const;
+   const Status getPageRecord(Page* page, const RID & rid, char* buf,
+                              Record & rec) const;
+   const int pageSlotCnt(const Page* page) const;
+   const int pageEval(const Conjunct terms[], const int numTerms,
+                      const Page* page, unsigned long long* sel) const;
+
+   vector<BTreeIndex*> indexes;  // open indexes, as in headerPage->indexes
+   // NONUNIQUEENTRY if a unique index already has rec's value
+   const Status indexCheck(const Record & rec);
+   // add or remove the entries of the record at rid in every index;
+   // indexInsert counts on indexCheck having been called
+   const Status indexInsert(const Record & rec, const RID & rid);
+   const Status indexDelete(const Record & rec, const RID & rid);
+   // take back what indexInsert (or, with deleted, indexDelete) did to
+   // the first numIndexes indexes
+   void indexUndo(const Record & rec, const RID & rid,
+                  const size_t numIndexes, const bool deleted);
+
 public:
 
   // initialize
@@ -58,6 +219,40 @@ public:
 
   // given a RID, read record from file, returning pointer and length
   const Status getRecord(const RID &rid, Record & rec);
+
+  // Read the records at rids[0..numRids) and pass each to sink with
+  // its index in rids; the record is only valid during the call.  The
+  // RIDs may come in any order: they are grouped by page and visited
+  // in pageNo order, each page pinned once.  The page being read and
+  // the next maxPinned-1 are kept pinned, and read-ahead is asked for
+  // the readAhead pages after those.  Read-ahead pages come in cold, so
+  // the pool may evict them before they are reached; it is off unless
+  // asked for.  Stops at the first RID that cannot be read and returns
+  // its status; BADSCANPARM if maxPinned is below 1.  The page
+  // getRecord has pinned is left alone.
+  typedef std::function<void(const int i, const Record& rec)> RecordSink;
+  const Status getRecords(const RID rids[], const int numRids,
+                          const RecordSink& sink,
+                          const int maxPinned = FETCHPINS,
+                          const int readAhead = 0);
+
+  // Build a B+-tree index on an attribute from the records in the file
+  // and keep it from then on.  INDEXEXISTS if there is one at offset
+  // already, FILEHDRFULL if the file has MAXINDEXES, NONUNIQUEENTRY if
+  // unique is set and two records share a value, BADINDEXPARM if the
+  // attribute is not valid.
+  const Status addIndex(const int offset, const int length,
+                        const Datatype type, const bool unique);
+
+  // the index on the attribute at offset, or NULL if there is none
+  BTreeIndex* getIndex(const int offset) const;
+
+  // Make the changes made so far durable.  The pages this object and
+  // its indexes keep pinned are logged and the log is forced (see
+  // wal.h), sharing the sync with other threads committing at the same
+  // time.  A file that is not logged is left to be written back when
+  // it is closed.
+  const Status commit();
 };
 
 
@@ -76,6 +271,14 @@ public:
                            const char* filter, 
                            const Operator op);
 
+    // AND another term into the filter set by startScan, so that the
+    // scan only returns records satisfying both
+    const Status addFilter(const int offset,
+                           const int length,
+                           const Datatype type,
+                           const char* filter,
+                           const Operator op);
+
     const Status endScan(); // terminate the scan
     const Status markScan(); // save current position of scan
     const Status resetScan(); // reset scan to last marked location
@@ -89,15 +292,41 @@ public:
     // delete current record 
     const Status deleteRecord();
 
-    // marks current page of scan dirty
+    // marks current page of scan dirty.  On a PAX file the record
+    // getRecord returns is a copy, put together from the columns, so
+    // changes to it only reach the page when markDirty is called for
+    // that record, before the scan moves on.
     const Status markDirty();
 
+    // number of pages to keep reading ahead of the scan; 0 disables
+    const Status setReadAhead(const int depth);
+
+    // read the pages the scan has to bring in through a scan ring of
+    // that many frames (see BufRing); 0, the default, turns it off
+    const Status setScanRing(const int frames);
+
+    // Run the whole scan on numThreads threads at once.  The data
+    // pages in the page directory are split evenly between the
+    // threads, which take SCANCHUNK pages at a time from their share;
+    // a thread whose share runs out takes half of what is left of
+    // another's.  Each record that passes the filter is passed to sink
+    // by the thread that found it, together with that thread's number
+    // (0 to numThreads-1) so results can be gathered per thread; the
+    // record is only valid during the call.  The position of the
+    // serial scan is not affected.
+    typedef std::function<void(const int thread, const RID& rid,
+                               const Record& rec)> ScanSink;
+    const Status parallelScan(const int numThreads, const ScanSink& sink);
+
 private:
-    int   offset;            // byte offset of filter attribute
-    int   length;            // length of filter attribute
-    Datatype type;           // datatype of filter attribute
-    const char* filter;      // comparison value of filter
-    Operator op;             // comparison operator of filter
+    vector<Conjunct> terms;  // filter terms, all of which must hold
+
+    // selection bitmap of the records of page selPageNo that pass the
+    // filter, made when the scan enters the page and remade if the
+    // number of slots on the page changes
+    unsigned long long sel[SELWORDS];
+    int   selPageNo;
+    int   selSlotCnt;
 
      // The following variables are used to preserve the state
     // of the scan when the method markScan() is invoked.
@@ -106,7 +335,20 @@ private:
     int   markedPageNo;	// page number of pinned page
     RID   markedRec;         // rid of last record returned
 
-    const bool matchRec(const Record & rec) const;
+    int   prevPageNo;        // page before chainPageNo, -1 if none
+    int   chainPageNo;       // last page the scan reached along the chain
+
+    bool  counted;           // counted among the file's open scans
+    vector<char> scanRec;    // PAX only: the record getRecord put
+    RID   scanRid;           // together, and its RID
+    BufRing* ring;           // scan ring, or NULL
+    int   readAhead;         // read-ahead depth in pages
+    int   prefetchCountdown; // pages to go before read-ahead is reissued
+
+    void  issueReadAhead();  // called each time the scan enters a page
+    // link the page before the empty, unpinned page pageNo to
+    // nextPageNo and dispose of pageNo
+    const Status unlinkPage(const int pageNo, const int nextPageNo);
 };
 
 
@@ -121,6 +363,35 @@ public:
 
     // insert record into file, returning its RID
     const Status insertRecord(const Record & rec, RID& outRid); 
+
+    // Bulk insert.  Records are appended to the last page and then to
+    // new pages, each packed full before the next is started, and the
+    // header is updated once.  The RIDs of the records inserted are
+    // appended to rids, so after an error rids says how far the load
+    // got.  The first form inserts recs[0..numRecs); the second takes
+    // records from next until it returns false (each record is copied
+    // before next is called again).  A file with indexes takes the
+    // records one at a time through insertRecord instead.
+    const Status insertRecords(const Record recs[], const int numRecs,
+                               vector<RID>& rids);
+    const Status insertRecords(const std::function<bool(Record&)>& next,
+                               vector<RID>& rids);
+
+    // With direct load on, insertRecords builds new pages in a private
+    // buffer and writes them straight to the file, LOADRUN at a time,
+    // instead of passing them through the buffer pool.  Such pages are
+    // left out of the free-space map until a delete frees space on them.
+    // If a run cannot be written, its pages and records are taken back
+    // out of the file, and rids, before insertRecords returns.
+    // Pages written around the pool would miss the log, so a logged
+    // file ignores it.
+    const Status setDirectLoad(const bool direct);
+
+private:
+    bool  directLoad;
+
+    // delete the record just inserted at rid and return status
+    const Status undoInsert(const RID & rid, const Status status);
 };
 
 #endif
@@ -0,0 +1,159 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Counters and latency histograms for the buffer manager and the
+// files under it.  Everything is updated with relaxed atomic adds, so
+// it is always on.
+
+const int COUNTERSTRIPES = 8;   // cache lines a counter is spread over
+const int LATBUCKETS = 32;      // latency histogram buckets
+
+inline long long nowNanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A 64-bit event counter.  Threads add to one of several cache lines,
+// picked once per thread, so that threads counting the same event do
+// not fight over one line; reading it sums the lines.
+class Counter
+{
+public:
+  Counter() { clear(); }
+
+  void add(const unsigned long long n = 1)
+    { stripes[stripe()].n.fetch_add(n, std::memory_order_relaxed); }
+  void operator ++ (int) { add(); }
+  void operator += (const unsigned long long n) { add(n); }
+
+  unsigned long long get() const
+  {
+    unsigned long long sum = 0;
+    for (int i = 0; i < COUNTERSTRIPES; i++)
+      sum += stripes[i].n.load(std::memory_order_relaxed);
+    return sum;
+  }
+  operator unsigned long long () const { return get(); }
+
+  void clear()
+  {
+    for (int i = 0; i < COUNTERSTRIPES; i++) stripes[i].n = 0;
+  }
+
+private:
+  struct alignas(64) Stripe { std::atomic<unsigned long long> n; };
+  Stripe stripes[COUNTERSTRIPES];
+
+  // the stripe of the calling thread, assigned on first use.  The
+  // thread_local is constant-initialized so that reading it needs no
+  // initialization guard.
+  static int stripe()
+  {
+    static thread_local int mine = -1;
+    if (__builtin_expect(mine < 0, 0)) mine = nextStripe();
+    return mine;
+  }
+  static int nextStripe()
+  {
+    static std::atomic<int> next(0);
+    return next++ % COUNTERSTRIPES;
+  }
+};
+
+// A histogram of latencies.  Bucket i counts latencies of at least
+// 2^i and less than 2^(i+1) nanoseconds; the last bucket also takes
+// everything longer.
+class LatencyHistogram
+{
+public:
+  LatencyHistogram() { clear(); }
+
+  void record(const long long nanos)
+  {
+    int b = 0;
+    if (nanos > 1) b = 63 - __builtin_clzll((unsigned long long) nanos);
+    if (b >= LATBUCKETS) b = LATBUCKETS - 1;
+    buckets[b].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nanos > 0 ? nanos : 0, std::memory_order_relaxed);
+  }
+
+  void clear()
+  {
+    for (int i = 0; i < LATBUCKETS; i++) buckets[i] = 0;
+    sum = 0;
+  }
+
+  friend struct HistogramSnapshot;
+
+private:
+  std::atomic<unsigned long long> buckets[LATBUCKETS];
+  std::atomic<unsigned long long> sum;   // nanoseconds
+};
+
+// What is counted for each file, by name, over the life of the
+// program; reopening a file carries on with the same counters.
+struct FileStats
+{
+  string  fileName;
+  Counter hits;        // readPage calls that found the page in the pool
+  Counter misses;      // readPage calls that read the page in
+  Counter evictions;   // pages evicted to make room for others
+  Counter writebacks;  // dirty pages written out by the buffer manager
+  Counter allocs;      // pages allocated
+  Counter disposes;    // pages disposed of
+  LatencyHistogram readLatency;   // File::intread system calls
+  LatencyHistogram writeLatency;  // page write system calls
+};
+
+// the FileStats of fileName, created on first use; never freed
+FileStats* getFileStats(const string& fileName);
+
+
+// Point-in-time copies, for reporting.  Counters are read one at a
+// time, so a snapshot taken while the pool is busy need not add up
+// exactly.
+
+struct HistogramSnapshot
+{
+  unsigned long long buckets[LATBUCKETS];
+  unsigned long long count;
+  unsigned long long sum;     // nanoseconds
+
+  void take(const LatencyHistogram& h);
+  // upper bound of the bucket holding the q quantile, in nanoseconds
+  long long quantile(const double q) const;
+};
+
+struct FileStatsSnapshot
+{
+  string fileName;
+  unsigned long long hits, misses, evictions, writebacks, allocs, disposes;
+  HistogramSnapshot readLatency, writeLatency;
+};
+
+struct BufStats;
+
+struct MetricsSnapshot
+{
+  // the pool; see BufStats.  Hits are the accesses that were not
+  // timed as misses.
+  unsigned long long accesses, hits, diskreads, diskwrites;
+  unsigned long long prefetchreads, prefetchhits, prefetchwasted;
+  unsigned long long syncwrites, writeruns, evictions, ringevictions;
+  unsigned long long allocs, disposes;
+  HistogramSnapshot missLatency;
+  vector<FileStatsSnapshot> files;   // every file ever opened
+
+  void take(const BufStats& pool);
+  string toJSON() const;
+  string toPrometheus() const;       // text exposition format
+};
+
+#endif
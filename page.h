@@ -17,46 +17,85 @@ struct Record
   int length;
 };
 
-// slot structure
+// slot structure.  Offsets and lengths are unsigned so that they
+// reach across a 64KB page.
 struct slot_t {
-        short	offset;  
-        short	length;  // equals -1 if slot is not in use
+        unsigned short	offset;  // next slot on the free list if empty
+        unsigned short	length;  // equals EMPTYSLOT if slot is not in use
 };
 
-const unsigned PAGESIZE = 1024;
-const unsigned DPFIXED= sizeof(slot_t)+4*sizeof(short)+2*sizeof(int);
-const unsigned PAGEDATASIZE = PAGESIZE-DPFIXED+sizeof(slot_t);
-// size of the data area of a page
+const unsigned short EMPTYSLOT = 0xFFFF;
+
+// Pages are a power of two bytes, chosen per database.  The size is
+// recorded in each file's DB header and in every data page.
+const int PAGESIZE = 1024;      // default page size
+const int MINPAGESIZE = 1024;
+const int MAXPAGESIZE = 65536;
+
+inline bool validPageSize(const int size)
+{
+  return size >= MINPAGESIZE && size <= MAXPAGESIZE && (size & (size - 1)) == 0;
+}
+
+const unsigned DPFIXED= sizeof(slot_t)+8*sizeof(int);
+// fixed part of a page: the header plus the first slot.  A page of
+// pageSize bytes has room for records of up to pageSize-DPFIXED bytes.
 
 // Class definition for a minirel data page.   
-// The design assumes that records are kept compacted when
-// deletions are performed. Notice, however, that the slot
-// array cannot be compacted.  Notice, this class does not keep
-// the records align, relying instead on upper levels to take
-// care of non-aligned attributes
+// A delete only marks the record's slot empty and puts it on a list
+// of free slots threaded through the empty slot entries; the hole it
+// leaves is counted as free space but only reclaimed when an insert
+// needs more contiguous room than is left, by compacting the page
+// once.  Slots keep their numbers, since RIDs refer to them, so the
+// slot array only shrinks by empty slots at its end.  Notice, this
+// class does not keep the records align, relying instead on upper
+// levels to take care of non-aligned attributes
+//
+// The class describes only the header at the front of a page.  The
+// data area follows it and the slot array grows backwards from the
+// end of the page, so a Page is only ever used through a pointer to
+// a whole page (a buffer pool frame or a mapped page).
 
 class Page {
 private:
-    char 	data[PAGESIZE - DPFIXED]; 
-    slot_t 	slot[1]; // first element of slot array - grows backwards!
-    short	slotCnt; // number of slots in use;
-    short	freePtr; // offset of first free byte in data[]
-    short	freeSpace; // number of bytes free in data[]
-    short	dummy;	// for alignment purposes
     int		nextPage; // forwards pointer
     int		curPage;  // page number of current pointer
+    int		pageSize; // size of the whole page in bytes
+    int		slotCnt; // number of slots in use;
+    int		freePtr; // offset of first free byte in data[]
+    int		freeSpace; // number of bytes free in data[], holes included
+    int		freeSlot; // first slot on the free list, -1 if none
+    int		recCnt;   // number of slots holding a record
+
+    char* dataArea() { return (char*) (this + 1); }
+    // first element of slot array - grows backwards!
+    slot_t* slotArray() { return (slot_t*) ((char*) this + pageSize) - 1; }
+    const slot_t* slotArray() const
+      { return (const slot_t*) ((const char*) this + pageSize) - 1; }
+
+    // bytes between the end of the records and the slot array
+    int contiguousFree() const
+      { return pageSize - (int) sizeof(Page) - freePtr
+               + slotCnt * (int) sizeof(slot_t); }
+    // close up the holes left by deletes, drop empty slots at the end
+    // of the slot array and rebuild the free list
+    void compact();
 
 public:
-    void init(const int pageNo); // initialize a new page
+    void init(const int pageNo, const int size); // initialize a new page
     void dumpPage() const;       // dump contents of a page
 
     const Status getNextPage(int& pageNo) const; // returns value of nextPage
     const Status setNextPage(const int pageNo); // sets value of nextPage to pageNo
-    const short getFreeSpace() const; // returns amount of free space
+    const int getFreeSpace() const; // returns amount of free space
 
     // inserts a new record (rec) into the page, returns RID of record 
     const Status insertRecord(const Record & rec, RID& rid);
 
+    // inserts rec into a new slot at the end of the slot array without
+    // looking for an empty slot to reuse; for bulk loading
+    const Status appendRecord(const Record & rec, RID& rid);
+
     // delete the record with the specified rid
     const Status deleteRecord(const RID & rid);
 
@@ -70,6 +109,13 @@ public:
 
     // returns reference to record with RID rid
     const Status getRecord(const RID & rid, Record & rec);
+
+    // raw view of the page for evaluating a predicate on every record
+    // at once: slot i, used or empty, is getSlots()[-i] for
+    // 0 <= i < getSlotCnt(), and its record starts at getData()+offset
+    const char* getData() const { return (const char*) (this + 1); }
+    const slot_t* getSlots() const { return slotArray(); }
+    const int getSlotCnt() const { return -slotCnt; }
 };
 
 #endif
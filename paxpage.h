@@ -0,0 +1,87 @@
+#ifndef PAXPAGE_H
+#define PAXPAGE_H
+
+#include "page.h"
+
+// PAX pages, for heap files whose records all have the same length and
+// are split into fixed-width columns.  Within a page each column is
+// stored in a minipage of its own, capacity values long, so that a
+// filter on one attribute reads only that attribute's bytes.  Which
+// record slots are in use is kept in a bitmap ahead of the minipages;
+// records here have no null attributes, so there is no null bitmap.
+// A record is put back together when it is asked for.
+//
+//   | header | used bitmap | column 0 | column 1 | ... |
+//
+// RIDs are (pageNo, slot), slot counting from 0 as on row pages.
+
+const int MAXCOLUMNS = 32;      // columns a PAX file can have
+
+// the column layout of a PAX file, and where it puts the minipages on
+// a page of a given size
+struct PaxSchema
+{
+  int		recLen;			// bytes in a record
+  int		colCnt;
+  int		colOffset[MAXCOLUMNS];	// where each column is in a record
+  int		colLen[MAXCOLUMNS];
+  int		capacity;		// records a page holds
+  int		colStart[MAXCOLUMNS];	// where each minipage is in a page
+
+  // Lay out colCnt columns of the given lengths, in record order, on
+  // pages of pageSize bytes.  INVALIDRECLEN if there are no columns,
+  // too many, or a page would not hold a record.
+  const Status init(const int colCnt, const int colLens[],
+                    const int pageSize);
+
+  // the column holding all of the attribute at offset, -1 if none does
+  const int columnOf(const int offset, const int length) const;
+};
+
+// A PaxPage starts like a Page, so the chain of data pages is walked
+// (by the buffer manager's read-ahead too) without knowing the format.
+class PaxPage {
+private:
+    int		nextPage; // forwards pointer, as in Page
+    int		curPage;  // page number of current pointer, as in Page
+    int		pageSize; // size of the whole page in bytes, as in Page
+    int		slotCnt;  // slots below this one have been used
+    int		recCnt;   // slots holding a record
+    int		pad;      // keeps the bitmap 8-byte aligned
+
+    unsigned long long* used() { return (unsigned long long*) (this + 1); }
+    const unsigned long long* used() const
+      { return (const unsigned long long*) (this + 1); }
+
+public:
+    void init(const PaxSchema& schema, const int pageNo, const int size);
+
+    // free space as the free-space map counts it: a record and a slot
+    // entry for every empty slot, as a row page would need
+    const int getFreeSpace(const PaxSchema& schema) const;
+
+    // store rec, of schema.recLen bytes, in the first empty slot;
+    // NOSPACE if the page is full
+    const Status insertRecord(const PaxSchema& schema, const Record & rec,
+                              RID& rid);
+    const Status deleteRecord(const RID & rid);
+    // write rec, of schema.recLen bytes, over the record at rid
+    const Status updateRecord(const PaxSchema& schema, const RID & rid,
+                              const Record & rec);
+    // as Page::firstRecord and Page::nextRecord
+    const Status firstRecord(RID& firstRid) const;
+    const Status nextRecord(const RID & curRid, RID& nextRid) const;
+    // copy the record at rid into buf and point rec at it
+    const Status getRecord(const PaxSchema& schema, const RID & rid,
+                           char* buf, Record & rec) const;
+
+    // for filtering a column at a time: slots 0..getSlotCnt()-1, bit
+    // i % 64 of getUsed()[i / 64] set if slot i holds a record, and
+    // the values of column c at getColumn(schema, c), colLen[c] apart
+    const int getSlotCnt() const { return slotCnt; }
+    const unsigned long long* getUsed() const { return used(); }
+    const char* getColumn(const PaxSchema& schema, const int c) const
+      { return (const char*) this + schema.colStart[c]; }
+};
+
+#endif
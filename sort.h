@@ -0,0 +1,80 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include "heapfile.h"
+
+// External merge sort of a heap file on one attribute.
+//
+// The file is read with a parallel HeapFileScan, each thread filling a
+// sort buffer of its own share of the memory budget.  A full buffer is
+// sorted (introsort, on an order-preserving 8-byte prefix of the key,
+// with the whole key breaking ties) and written out as a run to a
+// temporary file of its own, RUNIO pages at a time.  If nothing had to
+// be written, the sorted buffers are merged straight from memory.
+// Otherwise the runs are merged, as many at a time as the budget has
+// pages for, until few enough are left for a final merge, which is
+// what next returns records from.  Records too short to hold the
+// attribute sort before all others.
+
+const int RUNIO = 32;           // pages a run is written and read in at a time
+const int MINSORTFRAMES = 4;    // budget a sort thread needs, in pages
+
+struct SortBuffer;
+struct SortRun;
+class RunReader;
+
+class SortedFile
+{
+public:
+  // Sort heap file fileName on the attribute at offset, of length
+  // bytes and type type.  The sort uses at most maxFrames pages (of
+  // the buffer pool's page size) of memory for its buffers, on top of
+  // the pool itself, and numThreads threads to form runs.
+  // BADSORTPARM if the attribute is not valid or maxFrames gives a
+  // thread less than MINSORTFRAMES; INSUFMEM if the buffers cannot be
+  // had.
+  SortedFile(const string & fileName, const int offset, const int length,
+             const Datatype type, const int maxFrames, const int numThreads,
+             Status& status);
+  // removes any runs left
+  ~SortedFile();
+
+  // the next record in attribute order, valid until the next call;
+  // FILEEOF after the last
+  const Status next(Record & rec);
+
+  // Bulk-load the records next has still to return into a new heap
+  // file outName, in order.
+  const Status writeTo(const string & outName);
+
+  const int getRunCnt() const { return runCnt; }       // runs written
+  const int getMergePasses() const { return passes; }  // before the last
+
+private:
+  int		offset;		// the attribute
+  int		length;
+  Datatype	type;
+  size_t	budget;		// bytes of memory the sort may use
+  int		runPageSize;	// page size of the run files
+  string	runPrefix;	// run files are named runPrefix.runN
+  int		spillPages;	// block size a run is first written in
+  int		runCnt;
+  int		passes;
+
+  vector<SortBuffer*> buffers;	// in-memory runs, if nothing was written
+  vector<SortRun*> runs;	// runs on disk, not yet merged
+  vector<RunReader*> inputs;	// what the final merge reads
+  vector<int>	heap;		// inputs with records left, least on top
+  int		last;		// input next took its record from, or -1
+
+  // sort buf and write it as a new run, leaving buf empty
+  const Status spill(SortBuffer* buf, vector<SortRun*>& out);
+  // merge runs into a new run
+  const Status mergeRuns(vector<SortRun*>& in, SortRun*& out);
+  // open the final merge over inputs
+  const Status startMerge();
+  // least-first ordering of the heap
+  bool greater(const int a, const int b) const;
+};
+
+#endif
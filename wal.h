@@ -0,0 +1,143 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "db.h"
+
+// A redo-only write-ahead log, opened through DB::openLog.  Every
+// change to a page of a file opened while the log is on is appended to
+// one sequential log file before the page may be written back:
+//
+//   - the buffer manager keeps, for each frame of a logged file, an
+//     image of the page as last logged.  When the page is unpinned
+//     dirty (or logged while pinned, see BufMgr::logPage) the frame is
+//     compared with the image and the byte ranges that differ go to
+//     the log as one LOG_UPDATE record;
+//   - a newly allocated page is logged as LOG_FORMAT, all zeros, so
+//     that replay does not depend on what the page held before;
+//   - the File layer logs its own header and free-list changes.
+//
+// Commit makes everything appended so far durable.  Committers that
+// arrive while a write of the log is in progress wait for it and then
+// share the next one, so one fdatasync serves a whole group.  Data
+// pages are written back whenever the buffer manager gets to them,
+// after the log records that describe them.
+//
+// DB::openLog replays what the log holds into the files it names,
+// every record in order, and syncs them; then the log starts empty.
+// Replaying a record sets bytes to the values they were changed to, so
+// a page comes out as it was after its last logged change whatever
+// state the write-back had left it in.  There is no undo: changes not
+// yet committed when the system stopped may or may not survive.
+
+typedef unsigned long long LSN;   // offset in the log just past a record
+
+enum LogRecType {
+  LOG_FILE,     // fileId stands for the name that follows
+  LOG_UPDATE,   // ranges of pageNo changed to the bytes that follow
+  LOG_FORMAT,   // pageNo was allocated and zeroed
+  LOG_DESTROY   // the file was destroyed; its records are void
+};
+
+// A file gets a new id each time it is opened after being destroyed,
+// so the records of a destroyed file never apply to its successor.
+
+// every record starts with a LogRecHdr
+struct LogRecHdr
+{
+  unsigned int	length;		// bytes in the record, this header included
+  unsigned int	checksum;	// of everything after this field
+  int		type;		// a LogRecType
+  int		fileId;
+  int		pageNo;		// LOG_FILE: the file's page size
+};
+
+// a LOG_UPDATE carries LogRanges, each followed by length new bytes
+struct LogRange
+{
+  unsigned short offset;
+  unsigned short length;
+};
+
+const int LOGGAP = 16;            // unchanged bytes that still join two ranges
+const int LOGRANGEMAX = 0x8000;   // longest range, in bytes
+const int LOGBUFSIZE = 1 << 20;   // bytes appended before the log is
+                                  // written without waiting for a commit
+
+struct LogStats
+{
+  Counter commits;     // commit calls
+  Counter syncs;       // writes of the log, each ending in fdatasync
+  Counter records;     // records appended
+  Counter bytes;       // bytes appended
+  Counter replayed;    // records applied by recovery
+  LatencyHistogram syncLatency;  // each write and fdatasync of the log
+
+  void clear()
+    {
+      commits.clear(); syncs.clear(); records.clear(); bytes.clear();
+      replayed.clear(); syncLatency.clear();
+    }
+};
+
+class LogMgr
+{
+public:
+  LogMgr();
+  ~LogMgr();   // leaves the log as it is, for the next open to replay
+
+  // Open logName, creating it if need be, replay it and start it
+  // afresh.  No file it names may be open.
+  const Status open(const string & logName);
+  // Sync every file logged since open, then empty the log.  The files
+  // must all have been closed.
+  const Status close();
+
+  // the id records for fileName go under from now on
+  const int registerFile(const string & fileName, const int pageSize);
+
+  // Log the ranges where page differs from image, the page as last
+  // logged, and bring image up to date.  Returns the LSN of the
+  // record, or 0 if nothing changed.
+  LSN logUpdate(const int fileId, const int pageNo, const char* page,
+                char* image, const int pageSize);
+  // log that length bytes at offset of pageNo were set to bytes
+  LSN logBytes(const int fileId, const int pageNo, const int offset,
+               const void* bytes, const int length);
+  LSN logFormat(const int fileId, const int pageNo);
+  // Log that fileName is about to be destroyed and wait until that is
+  // on disk, so that replay cannot bring the file back.
+  const Status logDestroy(const string & fileName);
+
+  // make the log durable at least up to lsn
+  const Status flush(const LSN lsn);
+  // make everything appended so far durable
+  const Status commit();
+
+  const LogStats & getStats() const { return stats; }
+
+private:
+  int		fd;		// the log file, -1 if not open
+
+  std::mutex	latch;		// guards the fields below
+  std::map<string, int> fileIds;	// files registered since open
+  int		nextFileId;
+  std::condition_variable written;	// a write of the log finished
+  std::vector<char> buf;	// appended, not yet being written
+  std::vector<char> out;	// being written by the flushing thread
+  LSN		bufStart;	// log offset of buf
+  LSN		durable;	// the log is on disk up to here
+  bool		flushing;	// a thread is writing out
+
+  LogStats	stats;
+
+  // append a record, checksumming it first, and return its LSN
+  LSN append(std::vector<char>& rec);
+  // replay the records in the log into their files
+  const Status recover();
+};
+
+#endif